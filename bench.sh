@@ -0,0 +1,120 @@
+#!/bin/sh
+# Times parsing of a generated stress corpus, without printing the tree, and
+# fails when the median lines/s over RUNS runs drops more than THRESHOLD percent
+# below the baseline in bench.baseline. The baseline is only meaningful on the
+# machine that recorded it, so it isn't checked in, record one before comparing.
+#   ./bench.sh           compare against the baseline
+#   ./bench.sh record    store the current throughput as the new baseline
+#   ./bench.sh check     run every stress file once without timing, for sanitizer builds
+
+FITCH=${FITCH:-./fitch}
+STRESS=${STRESS:-_stress}
+THRESHOLD=${THRESHOLD:-10}
+RUNS=${RUNS:-9}
+BASELINE=bench.baseline
+
+generate() {
+  mkdir -p "$STRESS"
+
+  # a long flat proof
+  awk 'BEGIN {
+    print "pred P, Q"; print "const a"; print "P(a)"; print "Q"; print "---"
+    for (i = 0; i < 200000; i++)
+      print (i % 2 ? "^ (1) P(a) & Q" : "- -> (1, 2) !P(a) -> Q")
+  }' > "$STRESS/flat.fitch"
+
+  # many nested subproofs
+  awk 'BEGIN {
+    print "pred P, Q, R"; print "P"; print "---"
+    for (i = 0; i < 20000; i++) {
+      print "  Q"; print "  ---"
+      print "    R"; print "    ---"
+      print "    ^ (1) P"
+      print "  ^ (2) Q"
+      print "^ (1) P"
+    }
+  }' > "$STRESS/nested.fitch"
+
+  # long formulas with quantifiers, functions and parentheses
+  awk 'BEGIN {
+    print "pred P, Q"; print "const c"; print "func f, g"
+    print "@x (P(x) -> Q(f(x)))"; print "---"
+    for (i = 0; i < 50000; i++)
+      print "- @ (1) (P(f(g(c, c))) & !Q(c)) | (%y P(g(y, f(c))) <-> @z !(Q(z) -> P(f(z))))"
+  }' > "$STRESS/formulas.fitch"
+
+  # subproofs nested 400 deep, past the 256 indents the lexer once had room for,
+  # then parentheses and negations just under the parser's nesting limit of 1000
+  awk 'BEGIN {
+    print "pred P"; print "P"; print "---"
+    for (i = 0; i < 400; i++) {
+      pad = pad "  "; print pad "P"; print pad "---"
+    }
+    print pad "^ (1) P"
+    for (i = 0; i < 999; i++) { opening = opening "("; closing = closing ")"; negation = negation "!" }
+    for (i = 0; i < 499; i++) mixed = mixed "!("
+    for (i = 0; i < 100; i++) {
+      print "- -> (1) " opening "P" closing
+      print "- -> (1) " negation "P"
+      print "- -> (1) " mixed "P" substr(closing, 1, 499)
+    }
+  }' > "$STRESS/deep.fitch"
+}
+
+# the corpus is regenerated whenever this script changes
+if [ ! -d "$STRESS" ] || [ "$0" -nt "$STRESS" ]; then
+  rm -rf "$STRESS"
+  generate
+fi
+
+if [ "$1" = check ]; then
+  for file in "$STRESS"/*.fitch; do
+    if ! "$FITCH" "$file" > /dev/null; then
+      echo "fitch failed on $file" >&2
+      exit 1
+    fi
+  done
+  exit 0
+fi
+
+lines=0
+rates=
+for file in "$STRESS"/*.fitch; do
+  lines=$((lines + $(wc -l < "$file")))
+done
+
+run=0
+while [ $run -lt "$RUNS" ]; do
+  start=$(date +%s%N)
+  for file in "$STRESS"/*.fitch; do
+    if ! "$FITCH" --quiet "$file"; then
+      echo "fitch failed on $file" >&2
+      exit 1
+    fi
+  done
+  end=$(date +%s%N)
+  rates="$rates $(awk -v l=$lines -v ns=$((end - start)) 'BEGIN { printf "%d", l / (ns / 1e9) }')"
+  run=$((run + 1))
+done
+
+median=$(echo $rates | tr ' ' '\n' | sort -n | awk '{ rate[NR] = $1 } END { print rate[int((NR + 1) / 2)] }')
+echo "$median lines/s over $lines lines, median of $RUNS runs"
+
+if [ "$1" = record ]; then
+  echo "$median" > "$BASELINE"
+  echo "recorded as baseline"
+  exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+  echo "no baseline, run ./bench.sh record" >&2
+  exit 1
+fi
+
+baseline=$(cat "$BASELINE")
+floor=$((baseline * (100 - THRESHOLD) / 100))
+echo "baseline $baseline lines/s, failing below $floor lines/s"
+if [ "$median" -lt "$floor" ]; then
+  echo "throughput regression" >&2
+  exit 1
+fi
\ No newline at end of file
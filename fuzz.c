@@ -0,0 +1,42 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "module.h"
+
+// libFuzzer entry point, inputs starting with the compiled module magic go
+// through the module reader, everything else through the lexer and parser
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size > INT32_MAX) return 0;
+  setModuleLoading(0);
+
+  if (size >= 8 && !memcmp(data, "FITCHMOD", 8)) {
+    FILE *stream = fmemopen((void *)data, size, "rb");
+    Node module;
+    if (!readModule(stream, &module)) freeNode(module);
+    fclose(stream);
+    freeModules();
+    return 0;
+  }
+
+  TokenList tokens = lexer((const char *)data, size, 0);
+  Node tree = parser(&tokens);
+  freeNode(tree);
+  freeTokens(&tokens);
+  return 0;
+}
+
+#ifdef FUZZ_STDIN
+// runs a single input from stdin, for AFL and for replaying crashes
+int main(void) {
+  int length;
+  char *source = readSource(stdin, &length);
+  LLVMFuzzerTestOneInput((const uint8_t *)source, length);
+  free(source);
+  return 0;
+}
+#endif
\ No newline at end of file
@@ -4,60 +4,129 @@
 
 #include "lexer.h"
 
+static const char *symbolNames[] = { "end of input", "pred", "func", "const", "identifier", "number", "`,`", "`:`", "`=`", "`&`", "`|`", "`!`", "`-`", "introduction", "`^`", "`->`", "`<->`", "`$`", "`@`", "`%`", "`---`", "`(`", "`)`", "`[`", "`]`", "indent", "undent", "line break", "string" };
+
+const char *symbolName(Symbol symbol) {
+  return symbolNames[symbol];
+}
+
+// pos is the offset of the last character read
 typedef struct Info {
-  int row, col, SOL;
+  int pos, SOL;
 } Info;
 
 typedef struct Indent {
-  int depth, indents[256];
+  int depth, capacity, *indents;
 } Indent;
 
-char nextChar(FILE *stream, Info *info) {
-  char c = fgetc(stream);
+char *readSource(FILE *stream, int *length) {
+  int capacity = 4096;
+  char *source = malloc(capacity);
+  *length = 0;
+  size_t read;
+  while ((read = fread(source + *length, 1, capacity - *length - 1, stream)) > 0) {
+    *length += read;
+    if (*length + 1 == capacity) {
+      if (capacity > INT32_MAX / 2) {
+        fprintf(stderr, "Error! input is too large.\n");
+        exit(-1);
+      }
+      capacity *= 2;
+      source = realloc(source, capacity);
+    }
+  }
+  source[*length] = '\0';
+  return source;
+}
+
+int lineOf(TokenList *tokens, int offset) {
+  int low = 0, high = tokens->lineCount - 1;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (tokens->lines[mid] <= (uint32_t)offset) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return low + 1;
+}
+
+int colOf(TokenList *tokens, int offset) {
+  return offset - tokens->lines[lineOf(tokens, offset) - 1] + 1;
+}
+
+const char *sourceName(TokenList *tokens) {
+  return tokens->path ? tokens->path : "<stdin>";
+}
+
+int tokenRow(TokenList *tokens, Token token) {
+  return lineOf(tokens, token.offset);
+}
+
+int tokenCol(TokenList *tokens, Token token) {
+  return colOf(tokens, token.offset);
+}
+
+void lexError(TokenList *tokens, int offset, const char *message) {
+  fprintf(stderr, "%s at %s:%d:%d\n", message, sourceName(tokens), lineOf(tokens, offset), colOf(tokens, offset));
+  tokens->errors++;
+}
+
+int nextChar(TokenList *tokens, Info *info) {
+  if (info->pos < tokens->length) info->pos++;
+  if (info->pos == tokens->length) return EOF;
+  char c = tokens->source[info->pos];
   if (c == '\n') {
-    info->col = 1;
-    info->row++;
+    if (tokens->lineCount >= 64 && !(tokens->lineCount & (tokens->lineCount - 1))) {
+      tokens->lines = realloc(tokens->lines, tokens->lineCount * 2 * sizeof(uint32_t));
+    }
+    tokens->lines[tokens->lineCount++] = info->pos + 1;
     info->SOL = 1;
   } else {
-    info->col++;
     info->SOL = c == ' ' ? info->SOL : 0;
   }
-  return c;
-}
-
-char peek(FILE *stream) {
-  char c = fgetc(stream);
-  ungetc(c, stream);
-  return c;
+  return (unsigned char)c;
 }
 
-char expectChar(FILE *stream, Info *info, char expected) {
-  if (peek(stream) != expected) return 0;
-  return nextChar(stream, info);
+int peek(TokenList *tokens, Info *info) {
+  if (info->pos + 1 >= tokens->length) return EOF;
+  return (unsigned char)tokens->source[info->pos + 1];
 }
 
-void pushToken(TokenList *tokens, Token token) {
-  tokens->count++;
-  tokens->tokens = realloc(tokens->tokens, tokens->count * sizeof(Token));
-  tokens->tokens[tokens->count-1] = token;
+int expectChar(TokenList *tokens, Info *info, int expected) {
+  if (peek(tokens, info) != expected) return 0;
+  return nextChar(tokens, info);
 }
 
-char *appendChar(char *s, char c) {
-  int len = strlen(s);
-  char *out = realloc(s, len + 2);
-  out[len] = c;
-  out[len+1] = '\0';
-  return out;
+void pushToken(TokenList *tokens, Symbol type, int offset, int length) {
+  if (length > UINT16_MAX) {
+    lexError(tokens, offset, "Token too long");
+    length = UINT16_MAX;
+  }
+  if (tokens->count == tokens->capacity) {
+    tokens->capacity *= 2;
+    tokens->tokens = realloc(tokens->tokens, tokens->capacity * sizeof(Token));
+  }
+  tokens->tokens[tokens->count++] = (Token){ offset, length, type };
 }
 
-char *setString(char *ptr, const char *str) {
-  return strcpy(realloc(ptr, strlen(str) + 1), str);
+int matchWord(TokenList *tokens, int start, int end, const char *word) {
+  int len = strlen(word);
+  return end - start == len && !memcmp(tokens->source + start, word, len);
 }
 
-int matchIndent(Indent *indent, int len, Symbol *type) {
-  if (indent->indents[indent->depth] == len) return -1;
+// returns how many indent or undent tokens the line needs, a line that undents to
+// a width no open subproof has is a mismatch but still closes the subproofs it left
+int matchIndent(Indent *indent, int len, Symbol *type, int *mismatch) {
+  *mismatch = 0;
+  if (indent->indents[indent->depth] == len) return 0;
   if (indent->indents[indent->depth] < len) {
     indent->depth++;
+    if (indent->depth == indent->capacity) {
+      indent->capacity *= 2;
+      indent->indents = realloc(indent->indents, indent->capacity * sizeof(int));
+    }
     indent->indents[indent->depth] = len;
     *type = tok_indent;
     return 1;
@@ -68,31 +137,31 @@ int matchIndent(Indent *indent, int len, Symbol *type) {
     indent->depth--;
     count++;
   }
-  return indent->indents[indent->depth] == len ? count : 0;
+  *mismatch = indent->indents[indent->depth] != len;
+  return count;
 }
 
-TokenList lexer(FILE *stream) {
-  Info info = { 1, 1, 1 };
-  char c, *value;
-  Indent indentation = {0, {0}};
+TokenList lexer(const char *source, int length, const char *path) {
+  Info info = { -1, 1 };
+  int c;
+  Indent indentation = { 0, 16, calloc(16, sizeof(int)) };
   Symbol type;
-  TokenList tokens = {malloc(0), 0, 0};
+  TokenList tokens = { malloc(64 * sizeof(Token)), source, path, malloc(64 * sizeof(uint32_t)), length, 0, 64, 1, 0, 0, 0, 0, -1 };
+  tokens.lines[0] = 0;
 
-  c = nextChar(stream, &info);
+  c = nextChar(&tokens, &info);
   while (c != EOF) {
-    value = strcpy(malloc(1), "");
-    int row = info.row, col = info.col, sol = info.SOL;
-    
+    int start = info.pos, sol = info.SOL;
+
     if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
       do {
-        value = appendChar(value, c);
-        c = nextChar(stream, &info);
+        c = nextChar(&tokens, &info);
       } while ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
-      if (!strcmp(value, "pred")) {
+      if (matchWord(&tokens, start, info.pos, "pred")) {
         type = tok_predicate;
-      } else if (!strcmp(value, "const")) {
+      } else if (matchWord(&tokens, start, info.pos, "const")) {
         type = tok_constant;
-      } else if (!strcmp(value, "func")) {
+      } else if (matchWord(&tokens, start, info.pos, "func")) {
         type = tok_function;
       } else {
         type = tok_identifier;
@@ -100,182 +169,189 @@ TokenList lexer(FILE *stream) {
     } else if (c >= '1' && c <= '9') {
       type = tok_number;
         do {
-          value = appendChar(value, c);
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
         } while (c >= '0' && c <= '9');
     } else {
       switch (c) {
         case '/':
-          if ((c = expectChar(stream, &info, '/'))) {
+          if ((c = expectChar(&tokens, &info, '/'))) {
             while (c != '\n' && c != EOF) {
-              c = nextChar(stream, &info);
+              c = nextChar(&tokens, &info);
             }
-          } else if ((c = expectChar(stream, &info, '*'))) {
-            // c = nextChar(stream, &info);
-            while (!(expectChar(stream, &info, '*') && (c = expectChar(stream, &info, '/'))) && c != EOF) {
-              c = nextChar(stream, &info);
+          } else if ((c = expectChar(&tokens, &info, '*'))) {
+            // c = nextChar(&tokens, &info);
+            while (!(expectChar(&tokens, &info, '*') && (c = expectChar(&tokens, &info, '/'))) && c != EOF) {
+              c = nextChar(&tokens, &info);
             }
           } else {
-            fprintf(stderr, "Invalid character `%c` at %d:%d", c, info.row, info.col);
-            exit(-1);
+            lexError(&tokens, start, "Invalid character `/`");
           }
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           continue;
 
         case '<':
           type = tok_biconditional;
-          if (!expectChar(stream, &info, '-') || !expectChar(stream, &info, '>')) {
-            fprintf(stderr, "Invalid character `%c` at %d:%d", c, info.row, info.col);
-            exit(-1);
-          };
-          c = nextChar(stream, &info);
+          if (!expectChar(&tokens, &info, '-') || !expectChar(&tokens, &info, '>')) {
+            lexError(&tokens, start, "Invalid character `<`");
+            c = nextChar(&tokens, &info);
+            continue;
+          }
+          c = nextChar(&tokens, &info);
           break;
 
         case '-':
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           if (c == '>') {
             type = tok_conditional;
-            value = setString(value, "->");
-            c = nextChar(stream, &info);
-          } else if (c == '-' && expectChar(stream, &info, '-')) {
+            c = nextChar(&tokens, &info);
+          } else if (c == '-' && expectChar(&tokens, &info, '-')) {
             type = tok_proof;
-            value = setString(value, "---");
-            c = nextChar(stream, &info);
+            c = nextChar(&tokens, &info);
           } else {
             type = tok_elimination;
-            value = setString(value, "-");
           }
           break;
 
         case '^':
           type = tok_reiteration;
-          value = setString(value, "^");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '=':
           type = tok_identity;
-          value = setString(value, "=");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
         
         case '&':
           type = tok_conjunction;
-          value = setString(value, "&");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
         
         case '|':
           type = tok_disjunction;
-          value = setString(value, "|");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '!':
           type = tok_negation;
-          value = setString(value, "!");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '@':
           type = tok_forall;
-          value = setString(value, "@");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '%':
           type = tok_exists;
-          value = setString(value, "%");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '$':
           type = tok_contradiction;
-          value = setString(value, "$");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case ',':
           type = tok_separator;
-          value = setString(value, ",");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case ':':
           type = tok_colon;
-          value = setString(value, ":");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '(':
           type = tok_lparen;
-          value = setString(value, "(");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case ')':
           type = tok_rparen;
-          value = setString(value, ")");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case '[':
           type = tok_lsquare;
-          value = setString(value, "[");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case ']':
           type = tok_rsquare;
-          value = setString(value, "]");
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
-        case '\n':
-          if (peek(stream) != ' ') {
-            int pushed = matchIndent(&indentation, 0, &type);
-            if (!pushed) {
-              fprintf(stderr, "Indent mismatch at %d:%d\n", row, col);
-              exit(-1);
+        case '"':
+          c = nextChar(&tokens, &info);
+          while (c != '"') {
+            if (c == '\n' || c == EOF) {
+              lexError(&tokens, start, "Unterminated string");
+              break;
             }
+            c = nextChar(&tokens, &info);
+          }
+          // the token only covers the contents of the string
+          if (c == '"') {
+            pushToken(&tokens, tok_string, start + 1, info.pos - start - 1);
+            c = nextChar(&tokens, &info);
+          }
+          continue;
+
+        case '\n':
+          if (peek(&tokens, &info) != ' ') {
+            int mismatch, pushed = matchIndent(&indentation, 0, &type, &mismatch);
+            if (mismatch) lexError(&tokens, start + 1, "Indent mismatch");
             for (int i = 0; i < pushed; i++) {
-              pushToken(&tokens, (Token){ type, strcpy(malloc(strlen(value) + 1), value), row, col });
+              pushToken(&tokens, type, start + 1, 0);
             }
           }
         case ';':
           type = tok_break;
-          value = setString(value, " ");
-          value[0] = c;
-          c = nextChar(stream, &info);
+          c = nextChar(&tokens, &info);
           break;
 
         case ' ':
           do {
-            value = appendChar(value, c);
-            c = nextChar(stream, &info);
+            c = nextChar(&tokens, &info);
           } while (c == ' ');
           if (sol) {
-            int pushed = matchIndent(&indentation, strlen(value), &type);
-            if (!pushed) {
-              fprintf(stderr, "Indent mismatch at %d:%d\n", row, col);
-              exit(-1);
-            }
+            int mismatch, pushed = matchIndent(&indentation, info.pos - start, &type, &mismatch);
+            if (mismatch) lexError(&tokens, start, "Indent mismatch");
             for (int i = 0; i < pushed; i++) {
-              pushToken(&tokens, (Token){ type, strcpy(malloc(strlen(value) + 1), value), row, col });
+              pushToken(&tokens, type, start, info.pos - start);
             }
           }
-          free(value);
           continue;
 
         default:
-          fprintf(stderr, "Invalid character `%c` at %d:%d\n", c, row, col);
-          exit(-1);
+          if (c >= ' ' && c <= '~') {
+            fprintf(stderr, "Invalid character `%c` at %s:%d:%d\n", c, sourceName(&tokens), lineOf(&tokens, start), colOf(&tokens, start));
+          } else {
+            fprintf(stderr, "Invalid byte 0x%02x at %s:%d:%d\n", c, sourceName(&tokens), lineOf(&tokens, start), colOf(&tokens, start));
+          }
+          tokens.errors++;
+          c = nextChar(&tokens, &info);
+          continue;
       }
     }
 
-    pushToken(&tokens, (Token){ type, strcpy(malloc(strlen(value) + 1), value), row, col });
-    free(value);
+    pushToken(&tokens, type, start, info.pos - start);
+  }
+
+  // close any subproofs still open when the input ends without a newline
+  for (; indentation.depth > 0; indentation.depth--) {
+    pushToken(&tokens, tok_undent, length, 0);
   }
 
+  free(indentation.indents);
   return tokens;
+}
+
+void freeTokens(TokenList *tokens) {
+  free(tokens->tokens);
+  free(tokens->lines);
+  tokens->tokens = 0;
+  tokens->lines = 0;
+  tokens->count = tokens->capacity = tokens->lineCount = 0;
 }
\ No newline at end of file
@@ -1,20 +1,31 @@
 #include <stdio.h>
+#include <stdint.h>
 #ifndef LEXER_H
 #define LEXER_H
 
-typedef enum { tok_none, tok_predicate, tok_function, tok_constant, tok_identifier, tok_number, tok_separator, tok_colon, tok_identity, tok_conjunction, tok_disjunction, tok_negation, tok_elimination, tok_introduction, tok_reiteration, tok_conditional, tok_biconditional, tok_contradiction, tok_forall, tok_exists, tok_proof, tok_lparen, tok_rparen, tok_lsquare, tok_rsquare, tok_indent, tok_undent, tok_break } Symbol;
+typedef enum { tok_none, tok_predicate, tok_function, tok_constant, tok_identifier, tok_number, tok_separator, tok_colon, tok_identity, tok_conjunction, tok_disjunction, tok_negation, tok_elimination, tok_introduction, tok_reiteration, tok_conditional, tok_biconditional, tok_contradiction, tok_forall, tok_exists, tok_proof, tok_lparen, tok_rparen, tok_lsquare, tok_rsquare, tok_indent, tok_undent, tok_break, tok_string } Symbol;
 
+// a token is a slice of the source, its row and col are looked up in the line table
 typedef struct Token {
-  Symbol type;
-  char *value;
-  int row, col;
+  uint32_t offset;
+  uint16_t length;
+  uint8_t type;
 } Token;
 
 typedef struct TokenList {
   Token *tokens;
-  int count, current;
+  const char *source;
+  const char *path; // file the source came from, 0 for stdin
+  uint32_t *lines; // offset of the start of every line
+  int length, count, capacity, lineCount, current, errors, panic, depth, lastError;
 } TokenList;
 
-TokenList lexer(FILE *instream);
+char *readSource(FILE *instream, int *length);
+TokenList lexer(const char *source, int length, const char *path);
+void freeTokens(TokenList *tokens);
+const char *symbolName(Symbol symbol);
+const char *sourceName(TokenList *tokens);
+int tokenRow(TokenList *tokens, Token token);
+int tokenCol(TokenList *tokens, Token token);
 
 #endif
\ No newline at end of file
@@ -6,14 +6,19 @@
 
 #include "lexer.h"
 #include "parser.h"
+#include "module.h"
 
 struct arguments {
   char *args[1]; // input file
   int json;  // --json flag
+  char *compile; // --compile output file
+  int quiet; // --quiet flag
 };
 
 static struct argp_option options[] = {
   { "json", 'j', 0, 0, "Output json" },
+  { "compile", 'c', "FILE", 0, "Compile the input as a module to FILE" },
+  { "quiet", 'q', 0, 0, "Only report errors, don't print the tree" },
   {0}
 };
 
@@ -24,6 +29,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
     case 'j':
       arguments->json = 1;
       break;
+    case 'c':
+      arguments->compile = arg;
+      break;
+    case 'q':
+      arguments->quiet = 1;
+      break;
     case ARGP_KEY_ARG:
       if (state->arg_num >= 2) {
         argp_usage(state);
@@ -51,11 +62,14 @@ int main(int argc, char *argv[]) {
   struct arguments arguments;
   arguments.args[0] = "";
   arguments.json = 0;
+  arguments.compile = 0;
+  arguments.quiet = 0;
 
   argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
   FILE *instream;
-  if (isatty(fileno(stdin))) {
+  // an input file takes precedence over piped input, imports are resolved relative to it
+  if (arguments.args[0][0]) {
     instream = fopen(arguments.args[0], "r");
   } else {
     instream = stdin;
@@ -65,17 +79,50 @@ int main(int argc, char *argv[]) {
     exit(-1);
   }
 
-  TokenList tokens = lexer(instream);
+  int length;
+  char *source = readSource(instream, &length);
+  TokenList tokens = lexer(source, length, instream == stdin ? 0 : arguments.args[0]);
 
   // puts("\n");
   // for (int i = 0; i < tokens.count; i++) {
-  //   printf("%s", tokens.tokens[i].value);
+  //   printf("%.*s", tokens.tokens[i].length, source + tokens.tokens[i].offset);
   // }
   // puts("\n");
 
-  Node tree = parser(tokens);
+  if (arguments.compile) {
+    Node tree = moduleParser(&tokens);
+    if (tokens.errors) {
+      fprintf(stderr, "%d error%s, module not compiled.\n", tokens.errors, tokens.errors == 1 ? "" : "s");
+      exit(-1);
+    }
+    FILE *outstream = fopen(arguments.compile, "wb");
+    if (!outstream) {
+      fprintf(stderr, "Error! can't write to `%s`.\n", arguments.compile);
+      exit(-1);
+    }
+    writeModule(tree, outstream, instream == stdin ? 0 : arguments.args[0]);
+    fclose(outstream);
+    freeNode(tree);
+    freeModules();
+    freeTokens(&tokens);
+    free(source);
+    return 0;
+  }
+
+  Node tree = parser(&tokens);
 
-  printNodeToJSON(tree);
-  putchar('\n');
+  if (!arguments.quiet) {
+    printNodeToJSON(tree);
+    putchar('\n');
+  }
+  int errors = tokens.errors;
+  freeNode(tree);
+  freeModules();
+  freeTokens(&tokens);
+  free(source);
+  if (errors) {
+    fprintf(stderr, "%d error%s.\n", errors, errors == 1 ? "" : "s");
+    return -1;
+  }
   return 0;
 }
\ No newline at end of file
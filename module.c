@@ -0,0 +1,369 @@
+#define _XOPEN_SOURCE 700
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "lexer.h"
+#include "parser.h"
+
+// compiled modules start with this magic, followed by the format version, the path,
+// size and mtime of the source they were compiled from, the interned string table
+// and finally the tree in pre-order
+#define MODULE_MAGIC "FITCHMOD"
+#define MODULE_VERSION 2
+#define MODULE_MAX_DEPTH 4096
+
+// a serialized node is six 32-bit integers
+#define NODE_SIZE 24
+
+typedef struct Strings {
+  char **values;
+  int *slots;
+  int count, capacity;
+} Strings;
+
+typedef struct Loaded {
+  char **paths;
+  int count;
+} Loaded;
+
+// string tables of compiled modules, the nodes read from them share these
+typedef struct Tables {
+  char **tables;
+  int count;
+} Tables;
+
+static Loaded loaded = {0, 0};
+static Tables tables = {0, 0};
+static int loading = 1;
+
+// with loading turned off imports yield an empty module without touching the filesystem
+void setModuleLoading(int enabled) {
+  loading = enabled;
+}
+
+unsigned int hashString(const char *s) {
+  unsigned int hash = 2166136261u;
+  while (*s) {
+    hash = (hash ^ (unsigned char)*s++) * 16777619u;
+  }
+  return hash;
+}
+
+void growStrings(Strings *strings) {
+  free(strings->slots);
+  strings->capacity = strings->capacity ? strings->capacity * 2 : 64;
+  strings->slots = malloc(strings->capacity * sizeof(int));
+  for (int i = 0; i < strings->capacity; i++) strings->slots[i] = -1;
+  strings->values = realloc(strings->values, strings->capacity * sizeof(char *));
+  for (int i = 0; i < strings->count; i++) {
+    unsigned int slot = hashString(strings->values[i]) & (strings->capacity - 1);
+    while (strings->slots[slot] != -1) slot = (slot + 1) & (strings->capacity - 1);
+    strings->slots[slot] = i;
+  }
+}
+
+int intern(Strings *strings, char *value) {
+  if (!value) return -1;
+  if (strings->count * 2 >= strings->capacity) growStrings(strings);
+  unsigned int slot = hashString(value) & (strings->capacity - 1);
+  while (strings->slots[slot] != -1) {
+    if (!strcmp(strings->values[strings->slots[slot]], value)) return strings->slots[slot];
+    slot = (slot + 1) & (strings->capacity - 1);
+  }
+  strings->values[strings->count] = value;
+  strings->slots[slot] = strings->count;
+  return strings->count++;
+}
+
+void internNode(Strings *strings, Node node) {
+  intern(strings, node.value);
+  for (int i = 0; i < node.childCount; i++) {
+    internNode(strings, node.children[i]);
+  }
+}
+
+// integers are stored little endian so compiled modules are portable
+void writeInt(FILE *stream, int value) {
+  unsigned int u = value;
+  unsigned char bytes[4] = { u, u >> 8, u >> 16, u >> 24 };
+  fwrite(bytes, 1, 4, stream);
+}
+
+void writeLong(FILE *stream, long long value) {
+  writeInt(stream, value);
+  writeInt(stream, value >> 32);
+}
+
+void writeNode(FILE *stream, Strings *strings, Node node) {
+  writeInt(stream, node.type);
+  writeInt(stream, intern(strings, node.value));
+  writeInt(stream, node.row);
+  writeInt(stream, node.col);
+  writeInt(stream, node.valid);
+  writeInt(stream, node.childCount);
+  for (int i = 0; i < node.childCount; i++) {
+    writeNode(stream, strings, node.children[i]);
+  }
+}
+
+// `source` is the file the module was compiled from, 0 for stdin
+void writeModule(Node module, FILE *stream, const char *source) {
+  Strings strings = {0, 0, 0, 0};
+  internNode(&strings, module);
+
+  char *canonical = source ? realpath(source, 0) : 0;
+  struct stat info;
+  if (!canonical || stat(canonical, &info)) {
+    info.st_size = 0;
+    info.st_mtime = 0;
+  }
+
+  fwrite(MODULE_MAGIC, 1, strlen(MODULE_MAGIC), stream);
+  writeInt(stream, MODULE_VERSION);
+  int len = canonical ? strlen(canonical) : 0;
+  writeInt(stream, len);
+  fwrite(canonical, 1, len, stream);
+  writeLong(stream, info.st_size);
+  writeLong(stream, info.st_mtime);
+  free(canonical);
+
+  // the strings are stored back to back, each with its terminator, so a reader
+  // can load the whole table at once and point nodes straight into it
+  int size = 0;
+  for (int i = 0; i < strings.count; i++) size += strlen(strings.values[i]) + 1;
+  writeInt(stream, strings.count);
+  writeInt(stream, size);
+  for (int i = 0; i < strings.count; i++) {
+    fwrite(strings.values[i], 1, strlen(strings.values[i]) + 1, stream);
+  }
+  writeNode(stream, &strings, module);
+
+  free(strings.values);
+  free(strings.slots);
+}
+
+// reads are bounded by the bytes left in the file so a crafted module can't
+// make us allocate more than it could possibly describe
+typedef struct Reader {
+  FILE *stream;
+  long remaining;
+  char **strings;
+  int stringCount;
+  const char *error;
+} Reader;
+
+int readBytes(Reader *reader, void *buffer, long count) {
+  if (reader->error) return 0;
+  if (count > reader->remaining || fread(buffer, 1, count, reader->stream) != (size_t)count) {
+    reader->error = "truncated compiled module";
+    return 0;
+  }
+  reader->remaining -= count;
+  return 1;
+}
+
+int readInt(Reader *reader) {
+  unsigned char bytes[4];
+  if (!readBytes(reader, bytes, 4)) return 0;
+  return (int)(bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned int)bytes[3] << 24);
+}
+
+long long readLong(Reader *reader) {
+  unsigned int low = readInt(reader), high = readInt(reader);
+  return (long long)((unsigned long long)high << 32 | low);
+}
+
+void readError(Reader *reader, const char *message) {
+  if (!reader->error) reader->error = message;
+}
+
+Node readNode(Reader *reader, int depth) {
+  Node this = { 0, 0, malloc(0), 0, 0, 0, 0 };
+  if (depth > MODULE_MAX_DEPTH) {
+    readError(reader, "compiled module nested too deeply");
+    return this;
+  }
+  int type = readInt(reader), value = readInt(reader);
+  this.row = readInt(reader);
+  this.col = readInt(reader);
+  this.valid = readInt(reader);
+  int childCount = readInt(reader);
+  if (reader->error) return this;
+  if (type < expr_empty || type > expr_error) readError(reader, "invalid node in compiled module");
+  if (value < -1 || value >= reader->stringCount) readError(reader, "invalid string in compiled module");
+  if (childCount < 0 || childCount > reader->remaining / NODE_SIZE) readError(reader, "invalid node in compiled module");
+  if (reader->error) return this;
+
+  this.type = type;
+  if (value != -1) {
+    this.value = reader->strings[value];
+    this.shared = 1;
+  }
+  this.children = realloc(this.children, childCount * sizeof(Node));
+  while (this.childCount < childCount && !reader->error) {
+    this.children[this.childCount++] = readNode(reader, depth + 1);
+  }
+  return this;
+}
+
+// returns an error message, or 0 when `module` was read successfully
+const char *readModule(FILE *stream, Node *module) {
+  Reader reader = { stream, 0, 0, 0, 0 };
+  long start = ftell(stream);
+  if (start < 0 || fseek(stream, 0, SEEK_END)) return "can't read compiled module";
+  reader.remaining = ftell(stream) - start;
+  fseek(stream, start, SEEK_SET);
+
+  char magic[sizeof(MODULE_MAGIC) - 1];
+  if (!readBytes(&reader, magic, sizeof(magic)) || memcmp(magic, MODULE_MAGIC, sizeof(magic))) {
+    return "not a compiled module";
+  }
+  if (readInt(&reader) != MODULE_VERSION) return reader.error ? reader.error : "unsupported compiled module version";
+
+  int len = readInt(&reader);
+  if (len < 0 || len > reader.remaining) return reader.error ? reader.error : "invalid source in compiled module";
+  char *source = malloc(len + 1);
+  readBytes(&reader, source, len);
+  source[len] = '\0';
+  long long size = readLong(&reader), mtime = readLong(&reader);
+  // a module whose source has changed since it was compiled is stale, one shipped
+  // without its source is taken as is
+  struct stat info;
+  if (!reader.error && loading && len && !stat(source, &info) && (info.st_size != size || info.st_mtime != mtime)) {
+    readError(&reader, "compiled module is out of date with its source");
+  }
+  free(source);
+
+  int count = readInt(&reader), bytes = readInt(&reader);
+  if (count < 0 || bytes < count || bytes > reader.remaining) readError(&reader, "invalid string table in compiled module");
+  if (reader.error) return reader.error;
+  char *table = malloc(bytes);
+  readBytes(&reader, table, bytes);
+  if (!reader.error && count && table[bytes - 1] != '\0') readError(&reader, "invalid string table in compiled module");
+  reader.strings = malloc(count * sizeof(char *));
+  for (int offset = 0; !reader.error && reader.stringCount < count;) {
+    if (offset == bytes) {
+      readError(&reader, "invalid string table in compiled module");
+      break;
+    }
+    reader.strings[reader.stringCount++] = table + offset;
+    offset += strlen(table + offset) + 1;
+  }
+
+  Node this = readNode(&reader, 0);
+  if (!reader.error && this.type != expr_module) readError(&reader, "invalid root in compiled module");
+  free(reader.strings);
+  if (reader.error) {
+    freeNode(this);
+    free(table);
+    return reader.error;
+  }
+  *module = this;
+  tables.tables = realloc(tables.tables, (tables.count + 1) * sizeof(char *));
+  tables.tables[tables.count++] = table;
+  return 0;
+}
+
+// releases the string tables of every compiled module read so far and forgets which modules were loaded,
+// nodes read from compiled modules can't be used afterwards
+void freeModules(void) {
+  for (int i = 0; i < tables.count; i++) free(tables.tables[i]);
+  free(tables.tables);
+  tables = (Tables){0, 0};
+  for (int i = 0; i < loaded.count; i++) free(loaded.paths[i]);
+  free(loaded.paths);
+  loaded = (Loaded){0, 0};
+}
+
+int isCompiled(FILE *stream) {
+  char magic[sizeof(MODULE_MAGIC) - 1];
+  int compiled = fread(magic, 1, sizeof(magic), stream) == sizeof(magic) && !memcmp(magic, MODULE_MAGIC, sizeof(magic));
+  rewind(stream);
+  return compiled;
+}
+
+// paths in imports are relative to the directory of the importing file
+char *resolvePath(const char *base, const char *path) {
+  const char *slash = base ? strrchr(base, '/') : 0;
+  if (path[0] == '/' || !slash) return strcpy(malloc(strlen(path) + 1), path);
+  int dir = slash - base + 1;
+  char *resolved = malloc(dir + strlen(path) + 1);
+  memcpy(resolved, base, dir);
+  strcpy(resolved + dir, path);
+  return resolved;
+}
+
+int markLoaded(char *path) {
+  for (int i = 0; i < loaded.count; i++) {
+    if (!strcmp(loaded.paths[i], path)) return 0;
+  }
+  loaded.count++;
+  loaded.paths = realloc(loaded.paths, loaded.count * sizeof(char *));
+  loaded.paths[loaded.count - 1] = strcpy(malloc(strlen(path) + 1), path);
+  return 1;
+}
+
+// compiled modules embed their imports, those count as loaded too
+void markImports(Node node) {
+  if (node.type == expr_module && node.value) markLoaded(node.value);
+  for (int i = 0; i < node.childCount; i++) {
+    markImports(node.children[i]);
+  }
+}
+
+Node emptyModule(const char *path) {
+  Node this = { expr_module, 0, malloc(0), 0, 0, 0, 0 };
+  this.value = strcpy(malloc(strlen(path) + 1), path);
+  return this;
+}
+
+// every module is only loaded once, however its path is spelled, later imports of it
+// yield an empty module. syntax errors in the module are added to `errors`
+Node loadModule(char *path, int *errors) {
+  if (!loading) return emptyModule(path);
+
+  // modules are known by their canonical path, that is also what compiled modules store
+  char *canonical = realpath(path, 0);
+  FILE *stream = canonical ? fopen(canonical, "rb") : 0;
+  if (!stream) {
+    fprintf(stderr, "Error! module `%s` doesn't exist.\n", path);
+    (*errors)++;
+    free(canonical);
+    return emptyModule(path);
+  }
+  if (!markLoaded(canonical)) {
+    fclose(stream);
+    Node this = emptyModule(canonical);
+    free(canonical);
+    return this;
+  }
+
+  Node this;
+  if (isCompiled(stream)) {
+    const char *error = readModule(stream, &this);
+    if (error) {
+      fprintf(stderr, "Error! module `%s`: %s.\n", path, error);
+      (*errors)++;
+      this = (Node){ expr_module, 0, malloc(0), 0, 0, 0, 0 };
+    } else {
+      markImports(this);
+    }
+  } else {
+    int length;
+    char *source = readSource(stream, &length);
+    TokenList tokens = lexer(source, length, path);
+    this = moduleParser(&tokens);
+    *errors += tokens.errors;
+    freeTokens(&tokens);
+    free(source);
+  }
+  fclose(stream);
+
+  if (!this.shared) free(this.value);
+  this.value = canonical;
+  this.shared = 0;
+  return this;
+}
@@ -0,0 +1,13 @@
+#include <stdio.h>
+#include "parser.h"
+#ifndef MODULE_H
+#define MODULE_H
+
+char *resolvePath(const char *base, const char *path);
+Node loadModule(char *path, int *errors);
+void setModuleLoading(int enabled);
+void writeModule(Node module, FILE *outstream, const char *source);
+const char *readModule(FILE *instream, Node *module);
+void freeModules(void);
+
+#endif
@@ -4,19 +4,23 @@
 
 #include "parser.h"
 #include "lexer.h"
+#include "module.h"
+
+#define MAX_DEPTH 1000
 
 void printNodeToJSON(Node node);
 
 Token current(TokenList *tokens) {
-  if (tokens->current >= tokens->count) return (Token){tok_none};
+  if (tokens->current >= tokens->count) return (Token){ tokens->length, 0, tok_none };
   return tokens->tokens[tokens->current];
 }
 Token previous(TokenList *tokens) {
   return tokens->tokens[tokens->current - 1];
 }
 
+// never moves past the end, so accepting tok_none leaves previous() in bounds
 Token next(TokenList *tokens) {
-  tokens->current++;
+  if (tokens->current < tokens->count) tokens->current++;
   return current(tokens);
 }
 
@@ -32,32 +36,102 @@ int accept(TokenList *tokens, Symbol expected) {
   return 0;
 }
 
+// reports the first unexpected token and enters panic mode, in which further
+// errors are suppressed until the parser synchronizes again, a token that was
+// already reported once isn't reported again
 int expect(TokenList *tokens, Symbol expected) {
   if (accept(tokens, expected))
     return 1;
-  fprintf(stderr, "Wrong token type %d at token %s, token %d/%d, expected %d, previous %s\n", current(tokens).type, current(tokens).value, tokens->current, tokens->count, expected, previous(tokens).value);
-  exit(-1);
+  if (!tokens->panic && tokens->current != tokens->lastError) {
+    Token token = current(tokens);
+    if (token.type == tok_none) {
+      fprintf(stderr, "Syntax error at end of %s: expected %s\n", sourceName(tokens), symbolName(expected));
+    } else if (token.type == tok_identifier || token.type == tok_number || token.type == tok_string) {
+      fprintf(stderr, "Syntax error at %s:%d:%d: expected %s, got %s `%.*s`\n", sourceName(tokens), tokenRow(tokens, token), tokenCol(tokens, token), symbolName(expected), symbolName(token.type), token.length, tokens->source + token.offset);
+    } else {
+      fprintf(stderr, "Syntax error at %s:%d:%d: expected %s, got %s\n", sourceName(tokens), tokenRow(tokens, token), tokenCol(tokens, token), symbolName(expected), symbolName(token.type));
+    }
+    tokens->errors++;
+  }
+  tokens->lastError = tokens->current;
+  tokens->panic = 1;
+  return 0;
 }
 
+// skips a subproof up to and including its matching undent
+void skipSubproof(TokenList *tokens) {
+  int depth = 0;
+  do {
+    if (assert(tokens, tok_indent)) depth++;
+    if (assert(tokens, tok_undent)) depth--;
+    next(tokens);
+  } while (depth > 0 && !assert(tokens, tok_none));
+}
+
+// skips to the next line break, indent, undent or proof line and leaves panic mode,
+// nothing is skipped when the line already ended with its break or undent.
+// undents and proof lines end the callers' loops so they are never consumed here,
+// an indent is only skipped to make progress from `start`, together with its subproof
+void synchronize(TokenList *tokens, int start) {
+  if (!tokens->panic) return;
+  tokens->panic = 0;
+  if (tokens->current > start && (previous(tokens).type == tok_break || previous(tokens).type == tok_undent)) return;
+  while (!(
+    assert(tokens, tok_break) ||
+    assert(tokens, tok_indent) ||
+    assert(tokens, tok_undent) ||
+    assert(tokens, tok_proof) ||
+    assert(tokens, tok_none)
+  )) next(tokens);
+  if (tokens->current == start && assert(tokens, tok_indent)) skipSubproof(tokens);
+  accept(tokens, tok_break);
+}
+
+// children grow geometrically, the capacity is the next power of two
 void appendChild(Node *parent, Node child) {
-  parent->childCount++;
-  parent->children = realloc(parent->children, parent->childCount * sizeof(Node));
-  parent->children[parent->childCount - 1] = child;
+  if (!(parent->childCount & (parent->childCount - 1))) {
+    parent->children = realloc(parent->children, (parent->childCount ? parent->childCount * 2 : 1) * sizeof(Node));
+  }
+  parent->children[parent->childCount++] = child;
 }
 
 
-Node newNode(Expression expr, Token token) {
-  return (Node){ expr, 0, malloc(0), 0, token.row, token.col, 0 };
+Node newNode(TokenList *tokens, Expression expr, Token token) {
+  return (Node){ expr, 0, malloc(0), 0, tokenRow(tokens, token), tokenCol(tokens, token), 0 };
 }
-Node tokenToNode(Expression expr, Token token) {
-  Node this = newNode(expr, token);
-  this.value = malloc(strlen(token.value) + 1);
-  strcpy(this.value, token.value);
+Node tokenToNode(TokenList *tokens, Expression expr, Token token) {
+  Node this = newNode(tokens, expr, token);
+  this.value = malloc(token.length + 1);
+  memcpy(this.value, tokens->source + token.offset, token.length);
+  this.value[token.length] = '\0';
   return this;
 }
 
+// recursive rules go through here so deeply nested input can't overflow the stack
+Node nested(TokenList *tokens, Node (*rule)(TokenList *)) {
+  if (tokens->depth >= MAX_DEPTH) {
+    if (!tokens->panic) {
+      Token token = current(tokens);
+      fprintf(stderr, "Syntax error at %s:%d:%d: nested too deeply\n", sourceName(tokens), tokenRow(tokens, token), tokenCol(tokens, token));
+      tokens->errors++;
+      tokens->panic = 1;
+    }
+    return newNode(tokens, expr_error, current(tokens));
+  }
+  tokens->depth++;
+  Node this = rule(tokens);
+  tokens->depth--;
+  return this;
+}
+
+// turns the expected token into a node, or an error node in its place
+Node expectNode(TokenList *tokens, Symbol expected, Expression expr) {
+  if (expect(tokens, expected)) return tokenToNode(tokens, expr, previous(tokens));
+  return newNode(tokens, expr_error, current(tokens));
+}
+
 Node declaration(TokenList *tokens) {
-  Node this = tokenToNode(expr_declaration, current(tokens));
+  Node this = tokenToNode(tokens, expr_declaration, current(tokens));
   Expression expr;
   if (accept(tokens, tok_constant)) {
     expr = expr_constant;
@@ -67,25 +141,61 @@ Node declaration(TokenList *tokens) {
     expect(tokens, tok_predicate);
     expr = expr_predicate;
   }
-  expect(tokens, tok_identifier);
-  appendChild(&this, tokenToNode(expr, previous(tokens)));
+  appendChild(&this, expectNode(tokens, tok_identifier, expr));
   while (accept(tokens, tok_separator)) {
-    expect(tokens, tok_identifier);
-    appendChild(&this, tokenToNode(expr, previous(tokens)));
+    appendChild(&this, expectNode(tokens, tok_identifier, expr));
+  }
+  return this;
+}
+
+// `import` is only a keyword at the start of a header line followed by a string,
+// so it can still be used as a name everywhere else
+int isImport(TokenList *tokens) {
+  Token token = current(tokens);
+  return token.type == tok_identifier &&
+    token.length == 6 && !memcmp(tokens->source + token.offset, "import", 6) &&
+    tokens->current + 1 < tokens->count && tokens->tokens[tokens->current + 1].type == tok_string;
+}
+
+Node import(TokenList *tokens) {
+  next(tokens);
+  Node this = expectNode(tokens, tok_string, expr_import);
+  if (this.type == expr_import) {
+    char *path = resolvePath(tokens->path, this.value);
+    appendChild(&this, loadModule(path, &tokens->errors));
+    free(path);
   }
   return this;
 }
 
+void header(Node *this, TokenList *tokens) {
+  while (
+    isImport(tokens) ||
+    assert(tokens, tok_predicate) ||
+    assert(tokens, tok_constant) ||
+    assert(tokens, tok_function)
+  ) {
+    int start = tokens->current;
+    if (isImport(tokens)) {
+      appendChild(this, import(tokens));
+    } else {
+      appendChild(this, declaration(tokens));
+    }
+    expect(tokens, tok_break);
+    synchronize(tokens, start);
+  }
+}
+
 Node expression(TokenList *tokens);
 
 Node factor(TokenList *tokens) {
-  expect(tokens, tok_identifier);
-  Node this = tokenToNode(expr_identifier, previous(tokens));
+  Node this = expectNode(tokens, tok_identifier, expr_identifier);
+  if (this.type == expr_error) return this;
   if (accept(tokens, tok_lparen)) {
     this.type = expr_function;
-    appendChild(&this, factor(tokens));
+    appendChild(&this, nested(tokens, factor));
     while (accept(tokens, tok_separator)) {
-      appendChild(&this, factor(tokens));
+      appendChild(&this, nested(tokens, factor));
     }
     expect(tokens, tok_rparen);
   }
@@ -95,19 +205,19 @@ Node factor(TokenList *tokens) {
 Node term(TokenList *tokens) {
   Node this;
   if (accept(tokens, tok_negation)) {
-    this = tokenToNode(expr_negation, previous(tokens));
-    appendChild(&this, term(tokens));
+    this = tokenToNode(tokens, expr_negation, previous(tokens));
+    appendChild(&this, nested(tokens, term));
   } else if (accept(tokens, tok_lparen)) {
-    this = expression(tokens);
-    expect(tokens, tok_lparen);
+    this = nested(tokens, expression);
+    expect(tokens, tok_rparen);
   } else {
     this = factor(tokens);
     if (accept(tokens, tok_identity)) {
       Node left = this;
-      this = tokenToNode(expr_identity, previous(tokens));
+      this = tokenToNode(tokens, expr_identity, previous(tokens));
       appendChild(&this, left);
       appendChild(&this, factor(tokens));
-    } else {
+    } else if (this.type != expr_error) {
       this.type = expr_predicate;
     }
   }
@@ -116,21 +226,20 @@ Node term(TokenList *tokens) {
 
 Node quantifier(TokenList *tokens) {
   if (accept(tokens, tok_negation)) {
-    Node this = tokenToNode(expr_negation, previous(tokens));
-    appendChild(&this, quantifier(tokens));
+    Node this = tokenToNode(tokens, expr_negation, previous(tokens));
+    appendChild(&this, nested(tokens, quantifier));
     return this;
   }
   Node this;
   if (accept(tokens, tok_forall)) {
-    this = tokenToNode(expr_forall, previous(tokens));
+    this = tokenToNode(tokens, expr_forall, previous(tokens));
   } else if (accept(tokens, tok_exists)) {
-    this = tokenToNode(expr_exists, previous(tokens));
+    this = tokenToNode(tokens, expr_exists, previous(tokens));
   } else {
     return term(tokens);
   }
-  expect(tokens, tok_identifier);
-  appendChild(&this, tokenToNode(expr_variable, previous(tokens)));
-  appendChild(&this, quantifier(tokens));
+  appendChild(&this, expectNode(tokens, tok_identifier, expr_variable));
+  appendChild(&this, nested(tokens, quantifier));
   return this;
 }
 
@@ -138,14 +247,14 @@ Node conditional(TokenList *tokens) {
   Node this = quantifier(tokens);
   if (accept(tokens, tok_biconditional)) {
     Node left = this;
-    this = tokenToNode(expr_biconditional, previous(tokens));
+    this = tokenToNode(tokens, expr_biconditional, previous(tokens));
     appendChild(&this, left);
-    appendChild(&this, conditional(tokens));
+    appendChild(&this, nested(tokens, conditional));
   } else if (accept(tokens, tok_conditional)) {
     Node left = this;
-    this = tokenToNode(expr_conditional, previous(tokens));
+    this = tokenToNode(tokens, expr_conditional, previous(tokens));
     appendChild(&this, left);
-    appendChild(&this, conditional(tokens));
+    appendChild(&this, nested(tokens, conditional));
   }
   return this;
 }
@@ -154,21 +263,21 @@ Node expression(TokenList *tokens) {
   Node this = conditional(tokens);
   if (accept(tokens, tok_conjunction)) {
     Node left = this;
-    this = tokenToNode(expr_conjunction, previous(tokens));
+    this = tokenToNode(tokens, expr_conjunction, previous(tokens));
     appendChild(&this, left);
-    appendChild(&this, expression(tokens));
+    appendChild(&this, nested(tokens, expression));
   } else if (accept(tokens, tok_disjunction)) {
     Node left = this;
-    this = tokenToNode(expr_disjunction, previous(tokens));
+    this = tokenToNode(tokens, expr_disjunction, previous(tokens));
     appendChild(&this, left);
-    appendChild(&this, expression(tokens));
+    appendChild(&this, nested(tokens, expression));
   }
   return this;
 }
 
 Node premise(TokenList *tokens) {
   if (assert(tokens, tok_break)) {
-    return tokenToNode(expr_empty, current(tokens));
+    return tokenToNode(tokens, expr_empty, current(tokens));
   }
   Node this = expression(tokens);
   return this;
@@ -183,30 +292,28 @@ Node concludable(TokenList *tokens) {
     accept(tokens, tok_conjunction) ||
     accept(tokens, tok_disjunction) ||
     accept(tokens, tok_negation) ||
-    accept(tokens, tok_identity) ||
-    expect(tokens, tok_contradiction)
-  ) return tokenToNode(expr_literal, previous(tokens));
+    accept(tokens, tok_identity)
+  ) return tokenToNode(tokens, expr_literal, previous(tokens));
+  return expectNode(tokens, tok_contradiction, expr_literal);
 }
 
 Node reference(TokenList *tokens) {
-  Node this = newNode(expr_reference, current(tokens));
-  expect(tokens, tok_number);
-  appendChild(&this, tokenToNode(expr_number, previous(tokens)));
+  Node this = newNode(tokens, expr_reference, current(tokens));
+  appendChild(&this, expectNode(tokens, tok_number, expr_number));
   if (accept(tokens, tok_colon)) {
-    expect(tokens, tok_number);
-    appendChild(&this, tokenToNode(expr_number, previous(tokens)));
+    appendChild(&this, expectNode(tokens, tok_number, expr_number));
   }
   if (accept(tokens, tok_elimination)) {
     Node left = this;
-    this = tokenToNode(expr_reference_range, previous(tokens));
+    this = tokenToNode(tokens, expr_reference_range, previous(tokens));
     appendChild(&this, left);
-    appendChild(&this, reference(tokens));
+    appendChild(&this, nested(tokens, reference));
   }
   return this;
 }
 
 Node referenceList(TokenList *tokens) {
-  Node this = tokenToNode(expr_reference_list, current(tokens));
+  Node this = tokenToNode(tokens, expr_reference_list, current(tokens));
   expect(tokens, tok_lparen);
   appendChild(&this, reference(tokens));
   while (accept(tokens, tok_separator)) {
@@ -218,18 +325,18 @@ Node referenceList(TokenList *tokens) {
 
 Node conclusion(TokenList *tokens) {
   if (assert(tokens, tok_break)) {
-    return tokenToNode(expr_empty, current(tokens));
+    return tokenToNode(tokens, expr_empty, current(tokens));
   }
   Node this;
   if (accept(tokens, tok_introduction)) {
-    this = tokenToNode(expr_introduction, previous(tokens));
+    this = tokenToNode(tokens, expr_introduction, previous(tokens));
     appendChild(&this, concludable(tokens));
   } else if (accept(tokens, tok_elimination)) {
-    this = tokenToNode(expr_elimination, previous(tokens));
+    this = tokenToNode(tokens, expr_elimination, previous(tokens));
     appendChild(&this, concludable(tokens));
   } else {
-    expect(tokens, tok_reiteration);
-    this = tokenToNode(expr_reiteration, previous(tokens));
+    this = expectNode(tokens, tok_reiteration, expr_reiteration);
+    if (this.type == expr_error) return this;
   }
   appendChild(&this, referenceList(tokens));
   appendChild(&this, premise(tokens));
@@ -237,32 +344,40 @@ Node conclusion(TokenList *tokens) {
 }
 
 Node proof(TokenList *tokens) {
-  Node this = newNode(expr_proof, current(tokens));
+  Node this = newNode(tokens, expr_proof, current(tokens));
   if (accept(tokens, tok_lsquare)) {
-    Node var = tokenToNode(expr_declaration, previous(tokens));
-    expect(tokens, tok_identifier);
-    appendChild(&var, tokenToNode(expr_variable, previous(tokens)));
+    Node var = tokenToNode(tokens, expr_declaration, previous(tokens));
+    appendChild(&var, expectNode(tokens, tok_identifier, expr_variable));
     expect(tokens, tok_rsquare);
     appendChild(&this, var);
   }
   
-  Node premises = newNode(expr_premises, current(tokens));
-  while (!assert(tokens, tok_proof)) {
+  Node premises = newNode(tokens, expr_premises, current(tokens));
+  while (!(assert(tokens, tok_proof) || assert(tokens, tok_undent) || assert(tokens, tok_none))) {
+    int start = tokens->current;
     appendChild(&premises, premise(tokens));
     expect(tokens, tok_break);
+    synchronize(tokens, start);
   }
   expect(tokens, tok_proof);
   expect(tokens, tok_break);
+  synchronize(tokens, tokens->current);
   
-  Node conclusions = newNode(expr_conclusions, current(tokens));
+  Node conclusions = newNode(tokens, expr_conclusions, current(tokens));
   while (!(assert(tokens, tok_undent) || assert(tokens, tok_none))) {
+    int start = tokens->current;
     if (accept(tokens, tok_indent)) {
-      appendChild(&conclusions, proof(tokens));
+      appendChild(&conclusions, nested(tokens, proof));
       expect(tokens, tok_undent);
+      // an undent to column 0 comes before the break ending the subproof's last line
+      accept(tokens, tok_break);
     } else {
       appendChild(&conclusions, conclusion(tokens));
-      accept(tokens, tok_break) || expect(tokens, tok_none);
+      accept(tokens, tok_break) || assert(tokens, tok_undent) || expect(tokens, tok_none);
     }
+    synchronize(tokens, start);
+    // a stray `---` among the conclusions doesn't end this loop, step over it
+    if (tokens->current == start) next(tokens);
   }
   appendChild(&this, premises);
   appendChild(&this, conclusions);
@@ -270,24 +385,45 @@ Node proof(TokenList *tokens) {
 }
 
 Node fitch(TokenList *tokens) {
-  Node this = newNode(expr_fitch, current(tokens));
-  while (assert(tokens, tok_predicate) || assert(tokens, tok_constant)) {
-    appendChild(&this, declaration(tokens));
-    expect(tokens, tok_break);
-  }
+  Node this = newNode(tokens, expr_fitch, current(tokens));
+  header(&this, tokens);
   appendChild(&this, proof(tokens));
   return this;
 }
 
-Node parser(TokenList tokens) {
-  tokens.current = 0;
-  Node node = fitch(&tokens);
-  for (int i = 0; i < tokens.count; i++) {
-    free(tokens.tokens[i].value);
+// a module is a header optionally followed by a single proof, its lemma
+Node module(TokenList *tokens) {
+  Node this = newNode(tokens, expr_module, current(tokens));
+  header(&this, tokens);
+  if (!assert(tokens, tok_none)) {
+    appendChild(&this, proof(tokens));
   }
-  return node;
+  return this;
+}
+
+Node parser(TokenList *tokens) {
+  tokens->current = 0;
+  tokens->panic = 0;
+  tokens->depth = 0;
+  tokens->lastError = -1;
+  return fitch(tokens);
 }
 
+Node moduleParser(TokenList *tokens) {
+  tokens->current = 0;
+  tokens->panic = 0;
+  tokens->depth = 0;
+  tokens->lastError = -1;
+  return module(tokens);
+}
+
+void freeNode(Node node) {
+  for (int i = 0; i < node.childCount; i++) {
+    freeNode(node.children[i]);
+  }
+  free(node.children);
+  if (!node.shared) free(node.value);
+}
 
 void printNodeToJSON(Node node) {
   printf("{\"type\":%d,\"value\":", node.type);